@@ -9,10 +9,13 @@
 #include <cstdint>
 #include <type_traits>
 #include <exception>
+#include <algorithm>
+#include <cstring>
 #ifdef QT_VERSION
 #   include <QString>
 #endif // QT_VERSION
 #include "binstreamwrapfwd.hpp"
+#include "crc32c.hpp"
 
 namespace fcl {
 #ifdef _MSC_VER
@@ -27,6 +30,13 @@ public:
     }
 };
 
+class BrokenChecksum : public std::exception {
+public:
+    virtual const char *what() const noexcept override final {
+        return "data block is corrupted or truncated";
+    }
+};
+
 #ifdef _MSC_VER
 #   undef noexcept
 #endif
@@ -36,7 +46,21 @@ enum class UseExceptions {
     yes, no
 };
 
+enum class UseChecksums {
+    yes, no
+};
+
 namespace details {
+    // Checksummed stream layout: sequence of
+    // [uint32_t payload size][uint32_t crc32c of payload][payload]
+    // blocks. Writer emits a block each time it collects this many bytes.
+    constexpr size_t checksum_block_size = 64 * 1024;
+
+    struct ChecksumBlockHeader {
+        uint32_t size;
+        uint32_t crc;
+    };
+
     template <typename Type, unsigned N, unsigned Last>
     struct Reader {
         template <class StreamTy, typename... Tp>
@@ -77,12 +101,18 @@ public:
      * \param istr Input stream opend with std::ios::binary flag
      * \param useExceptions UseExceptions::yes if you want that this class notify you about
      * reading at eof using exceptions and UseExceptions::no if no
+     * \param useChecksums UseChecksums::yes if stream was written by BinOStreamWrap with
+     * UseChecksums::yes. Every block is verified as soon as it's read, broken one
+     * causes BrokenChecksum exception (or failbit on the stream if exceptions are off).
+     * Positioning functions aren't supported in this mode.
      */
     explicit BinIStreamWrap(
             StreamTy &istr,
-            UseExceptions useExceptions = UseExceptions::yes)
+            UseExceptions useExceptions = UseExceptions::yes,
+            UseChecksums useChecksums = UseChecksums::no)
         : m_istr(istr)
-        , m_useExceptions(useExceptions == UseExceptions::yes) {}
+        , m_useExceptions(useExceptions == UseExceptions::yes)
+        , m_useChecksums(useChecksums == UseChecksums::yes) {}
 
     BinIStreamWrap(const BinIStreamWrap &) = delete;
     BinIStreamWrap &operator =(const BinIStreamWrap &) = delete;
@@ -137,10 +167,7 @@ public:
     template <typename T>
     friend BinIStreamWrap &operator >>(BinIStreamWrap &is, T &t) {
         static_assert(std::is_trivially_copyable<T>::value, "T must be trivially copyable");
-        is.m_istr.read(reinterpret_cast<char *>(&t), sizeof(t));
-        if (is.m_istr.eof() && is.m_useExceptions) {
-            throw ReadingAtEOF();
-        }
+        is.read_raw(reinterpret_cast<char *>(&t), sizeof(t));
         return is;
     }
 
@@ -149,10 +176,7 @@ public:
         -> typename std::enable_if<
             std::is_trivially_copyable<T>::value,
             BinIStreamWrap &>::type {
-        is.m_istr.read(reinterpret_cast<char *>(t), sizeof(T) * I);
-        if (is.m_istr.eof() && is.m_useExceptions) {
-            throw ReadingAtEOF();
-        }
+        is.read_raw(reinterpret_cast<char *>(t), sizeof(T) * I);
         return is;
     }
 
@@ -163,7 +187,7 @@ public:
             BinIStreamWrap &>::type {
         for (auto &el : t) {
             is >> el;
-            if (is.m_istr.eof() && is.m_useExceptions) {
+            if (is.at_eof() && is.m_useExceptions) {
                 throw ReadingAtEOF();
             }
         }
@@ -178,14 +202,10 @@ public:
         uint64_t size;
         is >> size;
         vec.resize(static_cast<size_t>(size));
-        is.m_istr.read(
+        is.read_raw(
             reinterpret_cast<char *>(vec.data()),
             static_cast<size_t>(size) * sizeof(T)
         );
-
-        if (is.m_istr.eof() && is.m_useExceptions) {
-            throw ReadingAtEOF();
-        }
         return is;
     }
 
@@ -200,7 +220,7 @@ public:
 
         for (auto &el : vec) {
             is >> el;
-            if (is.m_istr.eof() && is.m_useExceptions) {
+            if (is.at_eof() && is.m_useExceptions) {
                 throw ReadingAtEOF();
             }
         }
@@ -216,7 +236,7 @@ public:
         for (auto &el: list) {
             is >> el;
         }
-        if (is.m_istr.eof() && is.m_useExceptions) {
+        if (is.at_eof() && is.m_useExceptions) {
             throw ReadingAtEOF();
         }
 
@@ -230,14 +250,10 @@ public:
         uint64_t size;
         is >> size;
         s.resize(static_cast<size_t>(size));
-        is.m_istr.read(
+        is.read_raw(
             reinterpret_cast<char *>(&s.front()),
             sizeof(CharT) * static_cast<size_t>(size)
         );
-
-        if (is.m_istr.eof() && is.m_useExceptions) {
-            throw ReadingAtEOF();
-        }
         return is;
     }
 
@@ -247,14 +263,10 @@ public:
         int32_t size;
         is >> size;
         str.resize(static_cast<int>(size));
-        is.m_istr.read(
+        is.read_raw(
             reinterpret_cast<char *>(str.data()),
             static_cast<size_t>(size) * sizeof(QChar)
         );
-
-        if (is.m_istr.eof() && is.m_useExceptions) {
-            throw ReadingAtEOF();
-        }
         return is;
     }
 #endif // QT_VERSION
@@ -265,10 +277,7 @@ public:
             std::pair<T *, uint64_t > &cArr) {
         is >> cArr.second;
         cArr.first = new T[cArr.second];
-        is.m_istr.read(reinterpret_cast<char *>(cArr.first), sizeof(T) * cArr.second);
-        if (is.m_istr.eof() && is.m_useExceptions) {
-            throw ReadingAtEOF();
-        }
+        is.read_raw(reinterpret_cast<char *>(cArr.first), sizeof(T) * cArr.second);
         return is;
     }
 
@@ -279,8 +288,96 @@ public:
     }
 
 private:
+    void read_raw(char *dst, size_t size) {
+        if (!m_useChecksums) {
+            m_istr.read(dst, size);
+            if (m_istr.eof() && m_useExceptions) {
+                throw ReadingAtEOF();
+            }
+            return;
+        }
+
+        while (size != 0) {
+            if (m_blockPos == m_block.size()) {
+                // Large reads land directly into destination, no extra copy
+                if (!read_block(dst, size)) {
+                    break;
+                }
+                continue;
+            }
+            const auto chunk = std::min(size, m_block.size() - m_blockPos);
+            std::memcpy(dst, m_block.data() + m_blockPos, chunk);
+            m_blockPos += chunk;
+            dst += chunk;
+            size -= chunk;
+        }
+
+        if (size != 0 && m_useExceptions) {
+            throw ReadingAtEOF();
+        }
+    }
+
+    /// Reads and verifies next block. Puts its payload right into
+    /// dst if it fits there, otherwise into m_block.
+    bool read_block(char *&dst, size_t &size) {
+        if (m_blocksEnded) {
+            return false;
+        }
+
+        details::ChecksumBlockHeader header;
+        m_istr.read(reinterpret_cast<char *>(&header), sizeof(header));
+        if (m_istr.gcount() == 0 && m_istr.eof()) {
+            m_blocksEnded = true;
+            return false;
+        }
+        if (static_cast<size_t>(m_istr.gcount()) != sizeof(header)) {
+            return broken_block();
+        }
+
+        const bool direct = header.size <= size;
+        char *payload = dst;
+        if (!direct) {
+            m_block.resize(header.size);
+            m_blockPos = 0;
+            payload = &m_block.front();
+        }
+
+        m_istr.read(payload, header.size);
+        if (static_cast<size_t>(m_istr.gcount()) != header.size
+                || crc32c(payload, header.size) != header.crc) {
+            m_block.clear();
+            m_blockPos = 0;
+            return broken_block();
+        }
+
+        if (direct) {
+            dst += header.size;
+            size -= header.size;
+        }
+        return true;
+    }
+
+    bool broken_block() {
+        m_blocksEnded = true;
+        if (m_useExceptions) {
+            throw BrokenChecksum();
+        }
+        m_istr.setstate(std::ios::failbit);
+        return false;
+    }
+
+    bool at_eof() const {
+        return m_useChecksums
+            ? m_blocksEnded && m_blockPos == m_block.size()
+            : m_istr.eof();
+    }
+
     StreamTy &m_istr;
     bool m_useExceptions;
+    bool m_useChecksums;
+    bool m_blocksEnded = false;
+    std::vector<char> m_block;
+    size_t m_blockPos = 0;
 };
 
 template <class StreamTy>
@@ -314,8 +411,22 @@ template <class StreamTy>
 class BinOStreamWrap
 {
 public:
-    explicit BinOStreamWrap(StreamTy &ostr)
-        : m_ostr(ostr) {}
+    /*!
+     * \brief BinOStreamWrap
+     * \param ostr Output stream opend with std::ios::binary flag
+     * \param useChecksums UseChecksums::yes if you want data to be split into blocks
+     * with CRC32C checksums, so reader could detect corruption or truncation.
+     * Positioning functions aren't supported in this mode.
+     */
+    explicit BinOStreamWrap(
+            StreamTy &ostr,
+            UseChecksums useChecksums = UseChecksums::no)
+        : m_ostr(ostr)
+        , m_useChecksums(useChecksums == UseChecksums::yes) {
+        if (m_useChecksums) {
+            m_block.reserve(details::checksum_block_size);
+        }
+    }
 
     BinOStreamWrap(const BinOStreamWrap &) = delete;
     BinOStreamWrap &operator =(const BinOStreamWrap &) = delete;
@@ -323,7 +434,17 @@ public:
     BinOStreamWrap(BinOStreamWrap &&) = default;
     BinOStreamWrap &operator =(BinOStreamWrap &&) = default;
 
-    ~BinOStreamWrap() = default;
+    ~BinOStreamWrap() {
+        flush();
+    }
+
+    /// Writes pending checksummed block. Does nothing if checksums are off.
+    void flush() {
+        if (!m_block.empty()) {
+            write_block(m_block.data(), m_block.size());
+            m_block.clear();
+        }
+    }
 
     int64_t get_opos() const {
         return m_ostr.tellp();
@@ -385,7 +506,7 @@ public:
     template <typename T>
     friend BinOStreamWrap &operator <<(BinOStreamWrap &os, const T &t) {
         static_assert(std::is_trivially_copyable<T>::value, "T must be trivially copyable");
-        os.m_ostr.write(reinterpret_cast<const char *>(&t), sizeof(t));
+        os.write_raw(reinterpret_cast<const char *>(&t), sizeof(t));
         return os;
     }
 
@@ -394,7 +515,7 @@ public:
         -> typename std::enable_if<
             std::is_trivially_copyable<T>::value,
             BinOStreamWrap &>::type {
-        os.m_ostr.write(reinterpret_cast<const char *>(array), sizeof(T) * I);
+        os.write_raw(reinterpret_cast<const char *>(array), sizeof(T) * I);
         return os;
     }
 
@@ -414,7 +535,7 @@ public:
             const std::vector<T, Alloc> &vec) {
         const auto size = static_cast<uint64_t>(vec.size());
         os << size;
-        os.m_ostr.write(
+        os.write_raw(
             reinterpret_cast<const char *>(vec.data()),
             sizeof(T) * static_cast<size_t>(size)
         );
@@ -440,7 +561,7 @@ public:
             const std::basic_string< CharT, Traits, Alloc> &s) {
         const auto size = static_cast<uint64_t>(s.size());
         os << size;
-        os.m_ostr.write(s.data(), sizeof(CharT) * static_cast<size_t>(size));
+        os.write_raw(s.data(), sizeof(CharT) * static_cast<size_t>(size));
         return os;
     }
 
@@ -448,7 +569,7 @@ public:
     friend BinOStreamWrap &operator <<(BinOStreamWrap &os, const QString &str) {
         int32_t size = str.size();
         os << size;
-        os.m_ostr.write(
+        os.write_raw(
             reinterpret_cast<const char *>(str.data()),
             static_cast<size_t>(size) * sizeof(QChar)
         );
@@ -461,7 +582,7 @@ public:
             BinOStreamWrap &os,
             const std::pair<T *, uint64_t> &cArr) {
         os << cArr.second;
-        os.m_ostr.write(
+        os.write_raw(
             reinterpret_cast<const char *>(cArr.first),
             sizeof(T) * cArr.second
         );
@@ -477,7 +598,43 @@ public:
     }
 
 private:
+    void write_raw(const char *src, size_t size) {
+        if (!m_useChecksums) {
+            m_ostr.write(src, size);
+            return;
+        }
+
+        if (m_block.empty()) {
+            // Large writes go straight from the source, no extra copy
+            for (; size >= details::checksum_block_size;
+                    src += details::checksum_block_size,
+                    size -= details::checksum_block_size) {
+                write_block(src, details::checksum_block_size);
+            }
+        }
+
+        while (size != 0) {
+            const auto chunk = std::min(size, details::checksum_block_size - m_block.size());
+            m_block.insert(m_block.end(), src, src + chunk);
+            src += chunk;
+            size -= chunk;
+            if (m_block.size() == details::checksum_block_size) {
+                flush();
+            }
+        }
+    }
+
+    void write_block(const char *data, size_t size) {
+        details::ChecksumBlockHeader header;
+        header.size = static_cast<uint32_t>(size);
+        header.crc = crc32c(data, size);
+        m_ostr.write(reinterpret_cast<const char *>(&header), sizeof(header));
+        m_ostr.write(data, size);
+    }
+
     StreamTy &m_ostr;
+    bool m_useChecksums;
+    std::vector<char> m_block;
 };
 
 template <class StreamTy>
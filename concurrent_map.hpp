@@ -0,0 +1,425 @@
+#pragma once
+#include <mutex>
+#include <atomic>
+#include <array>
+#include <vector>
+#include <memory>
+#include <thread>
+#include <functional>
+#include <type_traits>
+#include <utility>
+#include <cstring>
+#include <cstdint>
+#include <cassert>
+#include <boost/optional.hpp>
+
+
+namespace fcl {
+/*!
+ * \brief Hash map split into ShardsNb independently locked shards.
+ *
+ * Every shard is a flat open-addressing table (linear probing). Writers lock
+ * their shard only. If both Key and Value are trivially copyable, find() doesn't
+ * lock at all: it reads optimistically and retries if the shard was modified
+ * meanwhile (seqlock). For that replaced tables are kept until the map is destroyed,
+ * which costs at most as much memory as the current tables.
+ *
+ * Per-key access in mutex_guard style:
+ *
+ *     fcl::concurrent_map<uint64_t, stats_t> map;
+ *     map.lock(user_id)->hits++;
+ *
+ * \note Accessor locks the whole shard and blocks its optimistic readers, so keep
+ * it short and never hold two accessors at once (they may be on the same shard).
+ */
+template <
+    typename Key,
+    typename Value,
+    typename Hash = std::hash<Key>,
+    typename KeyEqual = std::equal_to<Key>,
+    typename MutexTy = std::mutex,
+    size_t ShardsNb = 64>
+class concurrent_map {
+    static_assert(ShardsNb != 0 && (ShardsNb & (ShardsNb - 1)) == 0,
+        "ShardsNb have to be a power of two");
+
+    static constexpr bool optimistic_reads =
+        std::is_trivially_copyable<Key>::value && std::is_trivially_copyable<Value>::value;
+
+    enum : uint8_t { slot_empty = 0, slot_full, slot_erased };
+
+    struct slot_t {
+        std::atomic<uint8_t> state;
+        typename std::aligned_storage<sizeof(Key), alignof(Key)>::type key;
+        typename std::aligned_storage<sizeof(Value), alignof(Value)>::type value;
+
+        Key &key_ref() {
+            return *reinterpret_cast<Key *>(&key);
+        }
+
+        Value &value_ref() {
+            return *reinterpret_cast<Value *>(&value);
+        }
+    };
+
+    struct table_t {
+        explicit table_t(size_t capacity)
+            : mask(capacity - 1)
+            , slots(new slot_t[capacity]) {
+            for (size_t i = 0; i < capacity; ++i) {
+                slots[i].state.store(slot_empty, std::memory_order_relaxed);
+            }
+        }
+
+        size_t mask;
+        std::unique_ptr<slot_t[]> slots;
+    };
+
+    struct shard_t {
+        std::atomic<uint64_t> seq{ 0 };
+        std::atomic<table_t *> table{ nullptr };
+        MutexTy mutex;
+        size_t size = 0;
+        size_t used = 0; // full + erased slots
+        std::vector<std::unique_ptr<table_t>> tables; // current one is the last
+        char padding[64]; // keeps neighbour shards off our cache lines
+
+        void begin_write() {
+            seq.store(seq.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+            std::atomic_thread_fence(std::memory_order_release);
+        }
+
+        void end_write() {
+            seq.store(seq.load(std::memory_order_relaxed) + 1, std::memory_order_release);
+        }
+    };
+
+public:
+    using key_type = Key;
+    using mapped_type = Value;
+
+    /// Exclusive access to one value. Holds the lock of the shard.
+    class accessor {
+        friend class concurrent_map;
+
+    public:
+        accessor(const accessor &) = delete;
+        accessor &operator =(const accessor &) = delete;
+
+        accessor(accessor &&other)
+            : m_lock(std::move(other.m_lock))
+            , m_shard(other.m_shard)
+            , m_slot(other.m_slot) {
+            other.m_shard = nullptr;
+        }
+
+        accessor &operator =(accessor &&) = delete;
+
+        ~accessor() {
+            if (m_shard) {
+                m_shard->end_write();
+            }
+        }
+
+        const Key &key() const {
+            return m_slot->key_ref();
+        }
+
+        Value *operator->() {
+            return &m_slot->value_ref();
+        }
+
+        Value &operator*() {
+            return m_slot->value_ref();
+        }
+
+    private:
+        accessor(std::unique_lock<MutexTy> &&lock, shard_t &shard, slot_t &slot)
+            : m_lock(std::move(lock))
+            , m_shard(&shard)
+            , m_slot(&slot) {}
+
+        std::unique_lock<MutexTy> m_lock;
+        shard_t *m_shard;
+        slot_t *m_slot;
+    };
+
+public:
+    concurrent_map() = default;
+
+    concurrent_map(const concurrent_map &) = delete;
+    concurrent_map &operator =(const concurrent_map &) = delete;
+
+    ~concurrent_map() {
+        for (auto &shard : m_shards) {
+            if (auto *table = shard.table.load(std::memory_order_relaxed)) {
+                destroy_slots(*table);
+            }
+        }
+    }
+
+    /// Locks value with the key, default-constructs it if there is none.
+    accessor lock(const Key &key) {
+        const auto hash = hash_of(key);
+        auto &shard = shard_of(hash);
+        std::unique_lock<MutexTy> lock(shard.mutex);
+        shard.begin_write();
+        auto *slot = find_slot(shard, key, hash);
+        if (!slot) {
+            slot = &insert_slot(shard, key, hash);
+            new (&slot->value) Value();
+        }
+        return { std::move(lock), shard, *slot };
+    }
+
+    /// Locks value with the key if there is one.
+    boost::optional<accessor> lock_existing(const Key &key) {
+        const auto hash = hash_of(key);
+        auto &shard = shard_of(hash);
+        std::unique_lock<MutexTy> lock(shard.mutex);
+        auto *slot = find_slot(shard, key, hash);
+        if (!slot) {
+            return boost::none;
+        }
+        shard.begin_write();
+        return accessor(std::move(lock), shard, *slot);
+    }
+
+    /// Copy of the value. Lock-free for trivially copyable keys and values.
+    boost::optional<Value> find(const Key &key) const {
+        return find_impl(key, std::integral_constant<bool, optimistic_reads>());
+    }
+
+    bool contains(const Key &key) const {
+        return static_cast<bool>(find(key));
+    }
+
+    /// \return false if the key is already there (value isn't changed then)
+    bool insert(const Key &key, Value value) {
+        const auto hash = hash_of(key);
+        auto &shard = shard_of(hash);
+        std::lock_guard<MutexTy> lock(shard.mutex);
+        if (find_slot(shard, key, hash)) {
+            return false;
+        }
+        shard.begin_write();
+        auto &slot = insert_slot(shard, key, hash);
+        new (&slot.value) Value(std::move(value));
+        shard.end_write();
+        return true;
+    }
+
+    /// \return true if the key was inserted, false if assigned
+    bool insert_or_assign(const Key &key, Value value) {
+        const auto hash = hash_of(key);
+        auto &shard = shard_of(hash);
+        std::lock_guard<MutexTy> lock(shard.mutex);
+        shard.begin_write();
+        auto *slot = find_slot(shard, key, hash);
+        const bool inserted = !slot;
+        if (inserted) {
+            slot = &insert_slot(shard, key, hash);
+            new (&slot->value) Value(std::move(value));
+        } else {
+            slot->value_ref() = std::move(value);
+        }
+        shard.end_write();
+        return inserted;
+    }
+
+    bool erase(const Key &key) {
+        const auto hash = hash_of(key);
+        auto &shard = shard_of(hash);
+        std::lock_guard<MutexTy> lock(shard.mutex);
+        auto *slot = find_slot(shard, key, hash);
+        if (!slot) {
+            return false;
+        }
+        shard.begin_write();
+        slot->key_ref().~Key();
+        slot->value_ref().~Value();
+        slot->state.store(slot_erased, std::memory_order_relaxed);
+        --shard.size;
+        shard.end_write();
+        return true;
+    }
+
+    /// Sum of shard sizes, it's not a snapshot if there are concurrent writers.
+    size_t size() const {
+        size_t result = 0;
+        for (auto &shard : m_shards) {
+            std::lock_guard<MutexTy> lock(shard.mutex);
+            result += shard.size;
+        }
+        return result;
+    }
+
+private:
+    static uint64_t hash_of(const Key &key) {
+        // std::hash is identity for integers, so spread bits before use
+        return static_cast<uint64_t>(Hash()(key)) * 0x9E3779B97F4A7C15ull;
+    }
+
+    static size_t start_index(uint64_t hash, size_t mask) {
+        return static_cast<size_t>(hash ^ (hash >> 29)) & mask;
+    }
+
+    shard_t &shard_of(uint64_t hash) const {
+        constexpr int shard_bits = log2(ShardsNb);
+        return m_shards[shard_bits ? static_cast<size_t>(hash >> (64 - shard_bits)) : 0];
+    }
+
+    static constexpr int log2(size_t n) {
+        return n <= 1 ? 0 : 1 + log2(n / 2);
+    }
+
+    boost::optional<Value> find_impl(const Key &key, std::true_type /*optimistic*/) const {
+        const auto hash = hash_of(key);
+        auto &shard = shard_of(hash);
+        for (;;) {
+            const auto seq_before = shard.seq.load(std::memory_order_acquire);
+            if (seq_before & 1) {
+                std::this_thread::yield();
+                continue;
+            }
+
+            bool found = false;
+            typename std::aligned_storage<sizeof(Key), alignof(Key)>::type key_copy;
+            typename std::aligned_storage<sizeof(Value), alignof(Value)>::type value_copy;
+            if (auto *table = shard.table.load(std::memory_order_acquire)) {
+                // bounded by capacity: torn reads must not loop us forever
+                for (size_t i = start_index(hash, table->mask), n = 0;
+                        n <= table->mask; i = (i + 1) & table->mask, ++n) {
+                    auto &slot = table->slots[i];
+                    const auto state = slot.state.load(std::memory_order_relaxed);
+                    if (state == slot_empty) {
+                        break;
+                    }
+                    if (state != slot_full) {
+                        continue;
+                    }
+                    std::memcpy(&key_copy, &slot.key, sizeof(Key));
+                    if (KeyEqual()(*reinterpret_cast<const Key *>(&key_copy), key)) {
+                        std::memcpy(&value_copy, &slot.value, sizeof(Value));
+                        found = true;
+                        break;
+                    }
+                }
+            }
+
+            std::atomic_thread_fence(std::memory_order_acquire);
+            if (shard.seq.load(std::memory_order_relaxed) == seq_before) {
+                if (!found) {
+                    return boost::none;
+                }
+                return *reinterpret_cast<const Value *>(&value_copy);
+            }
+        }
+    }
+
+    boost::optional<Value> find_impl(const Key &key, std::false_type /*optimistic*/) const {
+        const auto hash = hash_of(key);
+        auto &shard = shard_of(hash);
+        std::lock_guard<MutexTy> lock(shard.mutex);
+        auto *slot = find_slot(shard, key, hash);
+        if (!slot) {
+            return boost::none;
+        }
+        return slot->value_ref();
+    }
+
+    /// Shard must be locked
+    static slot_t *find_slot(shard_t &shard, const Key &key, uint64_t hash) {
+        auto *table = shard.table.load(std::memory_order_relaxed);
+        if (!table) {
+            return nullptr;
+        }
+        for (size_t i = start_index(hash, table->mask); ; i = (i + 1) & table->mask) {
+            auto &slot = table->slots[i];
+            const auto state = slot.state.load(std::memory_order_relaxed);
+            if (state == slot_empty) {
+                return nullptr;
+            }
+            if (state == slot_full && KeyEqual()(slot.key_ref(), key)) {
+                return &slot;
+            }
+        }
+    }
+
+    /// Shard must be locked and in write. Constructs key only, value is up to caller.
+    static slot_t &insert_slot(shard_t &shard, const Key &key, uint64_t hash) {
+        auto *table = shard.table.load(std::memory_order_relaxed);
+        if (!table || (shard.used + 1) * 4 > (table->mask + 1) * 3) {
+            table = rehash(shard);
+        }
+
+        for (size_t i = start_index(hash, table->mask); ; i = (i + 1) & table->mask) {
+            auto &slot = table->slots[i];
+            const auto state = slot.state.load(std::memory_order_relaxed);
+            if (state != slot_full) {
+                if (state == slot_empty) {
+                    ++shard.used;
+                }
+                ++shard.size;
+                new (&slot.key) Key(key);
+                slot.state.store(slot_full, std::memory_order_relaxed);
+                return slot;
+            }
+        }
+    }
+
+    /// Grows the table, or just drops erased slots if there are many of them.
+    static table_t *rehash(shard_t &shard) {
+        auto *old_table = shard.table.load(std::memory_order_relaxed);
+        size_t capacity = 16;
+        if (old_table) {
+            capacity = old_table->mask + 1;
+            if ((shard.size + 1) * 2 > capacity) {
+                capacity *= 2;
+            }
+        }
+
+        std::unique_ptr<table_t> table(new table_t(capacity));
+        if (old_table) {
+            for (size_t i = 0; i <= old_table->mask; ++i) {
+                auto &from = old_table->slots[i];
+                if (from.state.load(std::memory_order_relaxed) != slot_full) {
+                    continue;
+                }
+                const auto hash = hash_of(from.key_ref());
+                for (size_t j = start_index(hash, table->mask); ; j = (j + 1) & table->mask) {
+                    auto &to = table->slots[j];
+                    if (to.state.load(std::memory_order_relaxed) == slot_empty) {
+                        new (&to.key) Key(std::move(from.key_ref()));
+                        new (&to.value) Value(std::move(from.value_ref()));
+                        to.state.store(slot_full, std::memory_order_relaxed);
+                        break;
+                    }
+                }
+            }
+            if (!optimistic_reads) {
+                destroy_slots(*old_table);
+                shard.tables.pop_back();
+            }
+        }
+
+        shard.used = shard.size;
+        shard.table.store(table.get(), std::memory_order_release);
+        shard.tables.push_back(std::move(table));
+        return shard.tables.back().get();
+    }
+
+    static void destroy_slots(table_t &table) {
+        for (size_t i = 0; i <= table.mask; ++i) {
+            auto &slot = table.slots[i];
+            if (slot.state.load(std::memory_order_relaxed) == slot_full) {
+                slot.key_ref().~Key();
+                slot.value_ref().~Value();
+                slot.state.store(slot_erased, std::memory_order_relaxed);
+            }
+        }
+    }
+
+    mutable std::array<shard_t, ShardsNb> m_shards;
+};
+}
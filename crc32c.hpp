@@ -0,0 +1,116 @@
+#pragma once
+#include <cstdint>
+#include <cstddef>
+#include <cstring>
+#if defined(__x86_64__) || defined(_M_X64)
+#   define FCL_CRC32C_X86_64
+#   include <nmmintrin.h>
+#   ifdef _MSC_VER
+#       include <intrin.h>
+#   endif // _MSC_VER
+#endif // x86-64
+
+
+namespace fcl {
+namespace details {
+    // Castagnoli polynomial, reflected
+    constexpr uint32_t crc32c_poly = 0x82F63B78u;
+
+    struct crc32c_tables {
+        uint32_t t[8][256];
+
+        crc32c_tables() {
+            for (uint32_t i = 0; i < 256; ++i) {
+                uint32_t crc = i;
+                for (int k = 0; k < 8; ++k) {
+                    crc = (crc >> 1) ^ (crc32c_poly & (0u - (crc & 1u)));
+                }
+                t[0][i] = crc;
+            }
+            for (uint32_t i = 0; i < 256; ++i) {
+                for (int k = 1; k < 8; ++k) {
+                    t[k][i] = (t[k - 1][i] >> 8) ^ t[0][t[k - 1][i] & 0xFF];
+                }
+            }
+        }
+    };
+
+    inline const crc32c_tables &get_crc32c_tables() {
+        static const crc32c_tables tables;
+        return tables;
+    }
+
+    inline uint32_t load_le32(const unsigned char *p) {
+        return static_cast<uint32_t>(p[0])
+            | static_cast<uint32_t>(p[1]) << 8
+            | static_cast<uint32_t>(p[2]) << 16
+            | static_cast<uint32_t>(p[3]) << 24;
+    }
+
+    // Slicing-by-8: eight table lookups per 8 bytes instead of one per bit.
+    inline uint32_t crc32c_sw(uint32_t crc, const unsigned char *p, size_t size) {
+        const auto &t = get_crc32c_tables().t;
+        for (; size >= 8; size -= 8, p += 8) {
+            const uint32_t lo = load_le32(p) ^ crc;
+            const uint32_t hi = load_le32(p + 4);
+            crc = t[7][lo & 0xFF] ^ t[6][(lo >> 8) & 0xFF]
+                ^ t[5][(lo >> 16) & 0xFF] ^ t[4][lo >> 24]
+                ^ t[3][hi & 0xFF] ^ t[2][(hi >> 8) & 0xFF]
+                ^ t[1][(hi >> 16) & 0xFF] ^ t[0][hi >> 24];
+        }
+        for (; size != 0; --size, ++p) {
+            crc = (crc >> 8) ^ t[0][(crc ^ *p) & 0xFF];
+        }
+        return crc;
+    }
+
+#ifdef FCL_CRC32C_X86_64
+#   if defined(__GNUC__) && !defined(__SSE4_2__)
+    __attribute__((target("sse4.2")))
+#   endif
+    inline uint32_t crc32c_hw(uint32_t crc, const unsigned char *p, size_t size) {
+        uint64_t crc64 = crc;
+        for (; size >= 8; size -= 8, p += 8) {
+            uint64_t chunk;
+            std::memcpy(&chunk, p, sizeof(chunk));
+            crc64 = _mm_crc32_u64(crc64, chunk);
+        }
+        crc = static_cast<uint32_t>(crc64);
+        for (; size != 0; --size, ++p) {
+            crc = _mm_crc32_u8(crc, *p);
+        }
+        return crc;
+    }
+
+    inline bool cpu_has_sse42() {
+#   if defined(__SSE4_2__)
+        return true;
+#   elif defined(__GNUC__)
+        return __builtin_cpu_supports("sse4.2");
+#   elif defined(_MSC_VER)
+        int info[4];
+        __cpuid(info, 1);
+        return (info[2] & (1 << 20)) != 0;
+#   else
+        return false;
+#   endif
+    }
+#endif // FCL_CRC32C_X86_64
+}
+
+/*!
+ * \brief CRC-32C (Castagnoli) of the buffer
+ * \param crc Result of the previous call if you're checksumming data in parts
+ * \note Uses the SSE4.2 crc32 instruction when CPU supports it and slicing-by-8 otherwise
+ */
+inline uint32_t crc32c(const void *data, size_t size, uint32_t crc = 0) {
+    const auto *p = static_cast<const unsigned char *>(data);
+#ifdef FCL_CRC32C_X86_64
+    static const bool has_hw = details::cpu_has_sse42();
+    if (has_hw) {
+        return ~details::crc32c_hw(~crc, p, size);
+    }
+#endif // FCL_CRC32C_X86_64
+    return ~details::crc32c_sw(~crc, p, size);
+}
+}
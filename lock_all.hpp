@@ -0,0 +1,283 @@
+#pragma once
+#include <tuple>
+#include <utility>
+#include <type_traits>
+#include <thread>
+#include <mutex>
+#include <vector>
+#include <string>
+#include <sstream>
+#include <iostream>
+#include <functional>
+#include <unordered_map>
+#include <unordered_set>
+#include <algorithm>
+#include <new>
+#include <cstddef>
+
+
+namespace fcl {
+namespace details {
+    template <typename Ty>
+    auto try_lock_guard(Ty &obj, int) -> decltype(obj.try_lock()) {
+        return obj.try_lock();
+    }
+
+    template <typename Ty>
+    auto try_lock_guard(Ty &obj, long) -> decltype(obj.try_to_lock()) {
+        return obj.try_to_lock();
+    }
+
+    /// Storage for a guard that may be not taken yet
+    template <typename GuardTy>
+    class guard_slot {
+    public:
+        guard_slot() = default;
+        guard_slot(const guard_slot &) = delete;
+        guard_slot &operator =(const guard_slot &) = delete;
+
+        ~guard_slot() {
+            reset();
+        }
+
+        void emplace(GuardTy &&guard) {
+            new (&m_storage) GuardTy(std::move(guard));
+            m_engaged = true;
+        }
+
+        void reset() {
+            if (m_engaged) {
+                get().~GuardTy();
+                m_engaged = false;
+            }
+        }
+
+        GuardTy &get() {
+            return *reinterpret_cast<GuardTy *>(&m_storage);
+        }
+
+    private:
+        typename std::aligned_storage<sizeof(GuardTy), alignof(GuardTy)>::type m_storage;
+        bool m_engaged = false;
+    };
+
+    template <typename Fn, size_t ...Is>
+    void for_each_index(Fn &&fn, std::index_sequence<Is...>) {
+        using expander = int[];
+        (void)expander{ 0, (fn(std::integral_constant<size_t, Is>{}), 0)... };
+    }
+
+    template <typename ...Lockables, size_t ...Is>
+    auto lock_all(std::index_sequence<Is...> indices, Lockables &...objs)
+        -> std::tuple<decltype(objs.lock())...> {
+        constexpr size_t none = sizeof...(Lockables);
+        auto objects = std::tie(objs...);
+        std::tuple<guard_slot<decltype(objs.lock())>...> slots;
+
+        size_t first = 0;
+        for (;;) {
+            for_each_index([&](auto i) {
+                if (i == first) {
+                    std::get<i>(slots).emplace(std::get<i>(objects).lock());
+                }
+            }, indices);
+
+            size_t failed = none;
+            for_each_index([&](auto i) {
+                if (i == first || failed != none) {
+                    return;
+                }
+                auto guard = try_lock_guard(std::get<i>(objects), 0);
+                if (!guard) {
+                    failed = i;
+                    return;
+                }
+                std::get<i>(slots).emplace(std::move(*guard));
+            }, indices);
+
+            if (failed == none) {
+                return std::tuple<decltype(objs.lock())...>(std::move(std::get<Is>(slots).get())...);
+            }
+
+            // back off and start from the lock we couldn't get, so we wait on it
+            // instead of spinning around the hottest one
+            for_each_index([&](auto i) { std::get<i>(slots).reset(); }, indices);
+            first = failed;
+            std::this_thread::yield();
+        }
+    }
+}
+
+/*!
+ * \brief Locks several mutex_guard's/locking_shared_ptr's (anything with lock() and
+ * try_lock()/try_to_lock()) without deadlock, no matter in which order other threads
+ * lock them. Blocks on one object and tries the rest; on failure releases everything
+ * and starts over blocking on the object that was busy.
+ * \return std::tuple of guards, in the same order as arguments
+ * \note Objects sharing a non-recursive mutex (use_same_lock) can't be locked together.
+ */
+template <typename ...Lockables>
+auto lock_all(Lockables &...objs)
+    -> std::tuple<decltype(objs.lock())...> {
+    static_assert(sizeof...(Lockables) > 0, "nothing to lock");
+    return details::lock_all(std::index_sequence_for<Lockables...>{}, objs...);
+}
+
+
+/*!
+ * \brief Lock order checker: builds "locked A, then blocked on B" graph over all
+ * lock_order_checked mutexes and reports a cycle as soon as it appears, i.e. before
+ * the actual deadlock happens. Only blocking acquisitions produce edges: try_lock
+ * (and so lock_all) can't deadlock.
+ */
+class lock_order_tracker {
+public:
+    using handler_t = std::function<void (const std::string &)>;
+
+    static lock_order_tracker &instance() {
+        static lock_order_tracker &tracker = *new lock_order_tracker;
+        return tracker;
+    }
+
+    /// Called with cycle description. Default one prints it to std::cerr.
+    void set_handler(handler_t handler) {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_handler = std::move(handler);
+    }
+
+    void before_lock(const void *mutex) {
+        auto &held = held_locks();
+        if (held.empty() || std::find(held.begin(), held.end(), mutex) != held.end()) {
+            return;
+        }
+
+        std::string report;
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            for (auto *before : held) {
+                if (!m_graph[before].insert(mutex).second) {
+                    continue;
+                }
+                std::vector<const void *> path;
+                if (find_path(mutex, before, path)) {
+                    report = describe_cycle(path);
+                    break;
+                }
+            }
+        }
+
+        if (!report.empty()) {
+            handler_t handler;
+            {
+                std::lock_guard<std::mutex> lock(m_mutex);
+                handler = m_handler;
+            }
+            handler(report);
+        }
+    }
+
+    void locked(const void *mutex) {
+        held_locks().push_back(mutex);
+    }
+
+    void unlocked(const void *mutex) {
+        auto &held = held_locks();
+        auto it = std::find(held.rbegin(), held.rend(), mutex);
+        if (it != held.rend()) {
+            held.erase(std::next(it).base());
+        }
+    }
+
+    /// Mutex is destroyed, its address may be reused
+    void forget(const void *mutex) {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_graph.erase(mutex);
+        for (auto &node : m_graph) {
+            node.second.erase(mutex);
+        }
+    }
+
+private:
+    lock_order_tracker()
+        : m_handler([](const std::string &report) { std::cerr << report << std::endl; }) {}
+
+    static std::vector<const void *> &held_locks() {
+        static thread_local std::vector<const void *> held;
+        return held;
+    }
+
+    bool find_path(const void *from, const void *to, std::vector<const void *> &path) {
+        path.push_back(from);
+        if (from == to) {
+            return true;
+        }
+        auto node = m_graph.find(from);
+        if (node != m_graph.end()) {
+            for (auto *next : node->second) {
+                if (std::find(path.begin(), path.end(), next) == path.end()
+                        && find_path(next, to, path)) {
+                    return true;
+                }
+            }
+        }
+        path.pop_back();
+        return false;
+    }
+
+    static std::string describe_cycle(const std::vector<const void *> &path) {
+        std::ostringstream out;
+        out << "lock order inversion: ";
+        for (auto *mutex : path) {
+            out << mutex << " -> ";
+        }
+        out << path.front();
+        return out.str();
+    }
+
+    std::mutex m_mutex;
+    std::unordered_map<const void *, std::unordered_set<const void *>> m_graph;
+    handler_t m_handler;
+};
+
+/*!
+ * \brief Debug wrapper for any Lockable that reports lock order inversions
+ * to lock_order_tracker.
+ *
+ *     fcl::mutex_guard<Foo, fcl::lock_order_checked<std::recursive_mutex>> foo;
+ */
+template <typename MutexTy>
+class lock_order_checked {
+public:
+    lock_order_checked() = default;
+
+    lock_order_checked(const lock_order_checked &) = delete;
+    lock_order_checked &operator =(const lock_order_checked &) = delete;
+
+    ~lock_order_checked() {
+        lock_order_tracker::instance().forget(this);
+    }
+
+    void lock() {
+        auto &tracker = lock_order_tracker::instance();
+        tracker.before_lock(this);
+        m_mutex.lock();
+        tracker.locked(this);
+    }
+
+    bool try_lock() {
+        if (!m_mutex.try_lock()) {
+            return false;
+        }
+        lock_order_tracker::instance().locked(this);
+        return true;
+    }
+
+    void unlock() {
+        lock_order_tracker::instance().unlocked(this);
+        m_mutex.unlock();
+    }
+
+private:
+    MutexTy m_mutex;
+};
+}
@@ -0,0 +1,249 @@
+#pragma once
+#include <mutex>
+#include <atomic>
+#include <array>
+#include <vector>
+#include <map>
+#include <algorithm>
+#include <memory>
+#include <string>
+#include <chrono>
+#include <ostream>
+#include <iomanip>
+#include <sstream>
+#include <cstdint>
+
+
+namespace fcl {
+/// Contention statistics of one profiled_mutex. Histograms are log2 of nanoseconds.
+struct lock_stats {
+    static constexpr size_t buckets_nb = 40;
+    using histogram_t = std::array<std::atomic<uint64_t>, buckets_nb>;
+
+    lock_stats() {
+        for (size_t i = 0; i < buckets_nb; ++i) {
+            wait_hist[i].store(0, std::memory_order_relaxed);
+            hold_hist[i].store(0, std::memory_order_relaxed);
+        }
+    }
+
+    static size_t bucket(uint64_t ns) {
+        size_t b = 0;
+        while (ns > 1 && b + 1 < buckets_nb) {
+            ns >>= 1;
+            ++b;
+        }
+        return b;
+    }
+
+    std::atomic<uint64_t> acquires{ 0 };
+    std::atomic<uint64_t> contended{ 0 };
+    std::atomic<uint64_t> wait_ns{ 0 };
+    std::atomic<uint64_t> hold_ns{ 0 };
+    histogram_t wait_hist;
+    histogram_t hold_hist;
+};
+
+/*!
+ * \brief Registry of all profiled_mutex'es statistics. Stats outlive their mutexes,
+ * so you can dump the report at exit. Mutexes with the same name are merged in the report.
+ */
+class lock_profiler {
+public:
+    static lock_profiler &instance() {
+        static lock_profiler &profiler = *new lock_profiler;
+        return profiler;
+    }
+
+    std::shared_ptr<lock_stats> register_lock(const void *mutex) {
+        auto stats = std::make_shared<lock_stats>();
+        std::ostringstream name;
+        name << mutex;
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_locks.push_back({ name.str(), stats });
+        return stats;
+    }
+
+    void set_name(const lock_stats &stats, std::string name) {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        for (auto &entry : m_locks) {
+            if (entry.stats.get() == &stats) {
+                entry.name = std::move(name);
+            }
+        }
+    }
+
+    /// Forgets all collected statistics, mutexes keep being profiled
+    void reset() {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        for (auto &entry : m_locks) {
+            auto &stats = *entry.stats;
+            stats.acquires.store(0);
+            stats.contended.store(0);
+            stats.wait_ns.store(0);
+            stats.hold_ns.store(0);
+            for (size_t i = 0; i < lock_stats::buckets_nb; ++i) {
+                stats.wait_hist[i].store(0);
+                stats.hold_hist[i].store(0);
+            }
+        }
+    }
+
+    /// Table of locks sorted by total wait time, hottest first
+    void report(std::ostream &out) const {
+        struct summary_t {
+            uint64_t acquires = 0, contended = 0, wait_ns = 0, hold_ns = 0;
+            std::array<uint64_t, lock_stats::buckets_nb> wait_hist{}, hold_hist{};
+        };
+
+        std::map<std::string, summary_t> summaries;
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            for (auto &entry : m_locks) {
+                auto &sum = summaries[entry.name];
+                auto &stats = *entry.stats;
+                sum.acquires += stats.acquires.load(std::memory_order_relaxed);
+                sum.contended += stats.contended.load(std::memory_order_relaxed);
+                sum.wait_ns += stats.wait_ns.load(std::memory_order_relaxed);
+                sum.hold_ns += stats.hold_ns.load(std::memory_order_relaxed);
+                for (size_t i = 0; i < lock_stats::buckets_nb; ++i) {
+                    sum.wait_hist[i] += stats.wait_hist[i].load(std::memory_order_relaxed);
+                    sum.hold_hist[i] += stats.hold_hist[i].load(std::memory_order_relaxed);
+                }
+            }
+        }
+
+        std::vector<std::pair<std::string, summary_t>> sorted(summaries.begin(), summaries.end());
+        std::sort(sorted.begin(), sorted.end(), [](const auto &l, const auto &r) {
+            return l.second.wait_ns > r.second.wait_ns;
+        });
+
+        out << std::left << std::setw(32) << "lock"
+            << std::right << std::setw(12) << "acquires"
+            << std::setw(12) << "contended"
+            << std::setw(14) << "wait total"
+            << std::setw(12) << "wait p99"
+            << std::setw(12) << "hold avg"
+            << std::setw(12) << "hold p99" << '\n';
+        for (auto &entry : sorted) {
+            const auto &sum = entry.second;
+            const auto avg_hold = sum.acquires ? sum.hold_ns / sum.acquires : 0;
+            out << std::left << std::setw(32) << entry.first
+                << std::right << std::setw(12) << sum.acquires
+                << std::setw(12) << sum.contended
+                << std::setw(12) << sum.wait_ns << "ns"
+                << std::setw(10) << percentile(sum.wait_hist, 0.99) << "ns"
+                << std::setw(10) << avg_hold << "ns"
+                << std::setw(10) << percentile(sum.hold_hist, 0.99) << "ns" << '\n';
+        }
+    }
+
+private:
+    lock_profiler() = default;
+
+    /// Upper bound of the bucket the percentile falls into
+    template <typename Histogram>
+    static uint64_t percentile(const Histogram &hist, double p) {
+        uint64_t total = 0;
+        for (auto count : hist) {
+            total += count;
+        }
+        uint64_t seen = 0;
+        for (size_t i = 0; i < hist.size(); ++i) {
+            seen += hist[i];
+            if (total && seen >= p * total) {
+                return uint64_t(2) << i;
+            }
+        }
+        return 0;
+    }
+
+    struct entry_t {
+        std::string name;
+        std::shared_ptr<lock_stats> stats;
+    };
+
+    mutable std::mutex m_mutex;
+    std::vector<entry_t> m_locks;
+};
+
+/*!
+ * \brief Wrapper for any Lockable that collects acquire count, contended acquire count
+ * and wait/hold time histograms into lock_profiler.
+ *
+ *     fcl::mutex_guard<Foo, fcl::profiled_mutex<>> foo;
+ *     foo.get_mutex().set_name("foo cache");
+ *     ...
+ *     fcl::lock_profiler::instance().report(std::cerr);
+ */
+template <typename MutexTy = std::recursive_mutex>
+class profiled_mutex {
+    using clock_t = std::chrono::steady_clock;
+
+public:
+    profiled_mutex()
+        : m_stats(lock_profiler::instance().register_lock(this)) {}
+
+    profiled_mutex(const profiled_mutex &) = delete;
+    profiled_mutex &operator =(const profiled_mutex &) = delete;
+
+    /// Name in the report, by default it's the address
+    void set_name(std::string name) {
+        lock_profiler::instance().set_name(*m_stats, std::move(name));
+    }
+
+    void lock() {
+        if (m_mutex.try_lock()) {
+            acquired(clock_t::now(), 0, false);
+            return;
+        }
+        const auto wait_start = clock_t::now();
+        m_mutex.lock();
+        const auto now = clock_t::now();
+        acquired(now, to_ns(now - wait_start), true);
+    }
+
+    bool try_lock() {
+        if (!m_mutex.try_lock()) {
+            m_stats->contended.fetch_add(1, std::memory_order_relaxed);
+            return false;
+        }
+        acquired(clock_t::now(), 0, false);
+        return true;
+    }
+
+    void unlock() {
+        if (--m_depth == 0) {
+            const auto hold = to_ns(clock_t::now() - m_acquired_at);
+            m_stats->hold_ns.fetch_add(hold, std::memory_order_relaxed);
+            m_stats->hold_hist[lock_stats::bucket(hold)].fetch_add(1, std::memory_order_relaxed);
+        }
+        m_mutex.unlock();
+    }
+
+private:
+    static uint64_t to_ns(clock_t::duration duration) {
+        return static_cast<uint64_t>(
+            std::chrono::duration_cast<std::chrono::nanoseconds>(duration).count());
+    }
+
+    void acquired(clock_t::time_point now, uint64_t wait, bool contended) {
+        // m_depth and m_acquired_at are touched by the owner only
+        if (m_depth++ == 0) {
+            m_acquired_at = now;
+        }
+        auto &stats = *m_stats;
+        stats.acquires.fetch_add(1, std::memory_order_relaxed);
+        if (contended) {
+            stats.contended.fetch_add(1, std::memory_order_relaxed);
+            stats.wait_ns.fetch_add(wait, std::memory_order_relaxed);
+        }
+        stats.wait_hist[lock_stats::bucket(wait)].fetch_add(1, std::memory_order_relaxed);
+    }
+
+    MutexTy m_mutex;
+    std::shared_ptr<lock_stats> m_stats;
+    unsigned m_depth = 0;
+    clock_t::time_point m_acquired_at;
+};
+}
@@ -5,34 +5,38 @@
 
 
 namespace fcl {
-    template <typename Ty>
+    template <typename Ty, typename MutexTy = std::recursive_mutex>
     class locking_shared_ptr;
 
     struct use_own_lock_policy {};
 
-    template <typename Ty>
+    template <typename Ty, typename MutexTy = std::recursive_mutex>
     struct use_same_lock_policy {
-        const locking_shared_ptr<Ty> &m_other;
-        use_same_lock_policy(locking_shared_ptr<Ty> &other)
+        const locking_shared_ptr<Ty, MutexTy> &m_other;
+        use_same_lock_policy(locking_shared_ptr<Ty, MutexTy> &other)
             : m_other(other) {}
     };
 
-    template <typename Ty>
-    auto use_same_lock(locking_shared_ptr<Ty> &other)
-        -> use_same_lock_policy<Ty> {
-        return use_same_lock_policy<Ty>(other);
+    template <typename Ty, typename MutexTy>
+    auto use_same_lock(locking_shared_ptr<Ty, MutexTy> &other)
+        -> use_same_lock_policy<Ty, MutexTy> {
+        return use_same_lock_policy<Ty, MutexTy>(other);
     }
 
-    template <typename Ty>
+    /*!
+     * \param MutexTy Any Lockable, see mutexes.hpp for some.
+     * Nested lock() of the same (or use_same_lock-shared) pointer needs a recursive one.
+     */
+    template <typename Ty, typename MutexTy>
     class locking_shared_ptr {
-        template <typename OtherTy>
+        template <typename OtherTy, typename OtherMutexTy>
         friend class locking_shared_ptr;
 
         struct try_to_lock {};
 
     public:
         using ptr_t = std::shared_ptr<Ty>;
-        using mutex_t = std::recursive_mutex;
+        using mutex_t = MutexTy;
 
         class locked_ptr {
             friend class locking_shared_ptr;
@@ -143,9 +147,14 @@ namespace fcl {
             return m_ptr.get();
         }
 
+        /// For mutex types with settings, e.g. profiled_mutex
+        mutex_t &get_mutex() const {
+            return *m_mutex;
+        }
+
     private:
         template<typename OtherTy>
-        static auto make_mutex(use_same_lock_policy<OtherTy> &other)
+        static auto make_mutex(use_same_lock_policy<OtherTy, MutexTy> &other)
             -> std::shared_ptr<mutex_t> {
             return other.m_other.m_mutex;
         }
@@ -1,13 +1,19 @@
 #pragma once
 #include <mutex>
 #include <memory>
+#include <cassert>
 
 
 namespace fcl {
-template <typename Ty>
+/*!
+ * \param MutexTy Any Lockable, see mutexes.hpp for some.
+ * Note that clock_guard and lock_guard taken by the same thread at the same time
+ * need a recursive one.
+ */
+template <typename Ty, typename MutexTy = std::recursive_mutex>
 class mutex_guard {
 public:
-    using mutex_t = std::recursive_mutex;
+    using mutex_t = MutexTy;
 
     template <typename InnerTy>
     class lock_guard_base {
@@ -133,7 +139,7 @@ public:
     opt_lock_guard try_to_lock() {
         auto guard = lock_guard{ m_mutex, std::try_to_lock, m_data };
         if (guard.owns_lock()) {
-            return { guard };
+            return opt_lock_guard(new lock_guard(std::move(guard)));
         }
         return nullptr;
     }
@@ -145,7 +151,7 @@ public:
     opt_clock_guard try_to_lock() const {
         auto guard = clock_guard{ m_mutex, std::try_to_lock, m_data };
         if (guard.owns_lock()) {
-            return { guard };
+            return opt_clock_guard(new clock_guard(std::move(guard)));
         }
         return nullptr;
     }
@@ -166,6 +172,11 @@ public:
         return &m_data;
     }
 
+    /// For mutex types with settings, e.g. profiled_mutex
+    mutex_t &get_mutex() const {
+        return m_mutex;
+    }
+
 private:
     Ty m_data;
     mutable mutex_t m_mutex;
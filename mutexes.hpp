@@ -0,0 +1,143 @@
+#pragma once
+#include <atomic>
+#include <mutex>
+#include <thread>
+#include <cstdint>
+#if defined(__x86_64__) || defined(__i386__) || defined(_M_X64) || defined(_M_IX86)
+#   include <immintrin.h>
+#   define FCL_MUTEXES_PAUSE() _mm_pause()
+#else
+#   define FCL_MUTEXES_PAUSE() ((void)0)
+#endif
+#ifdef __linux__
+#   include <linux/futex.h>
+#   include <sys/syscall.h>
+#   include <unistd.h>
+#endif // __linux__
+
+
+// Mutex types for mutex_guard and locking_shared_ptr. All of them are
+// padded to the cache line, so guarded data doesn't share a line with the lock.
+namespace fcl {
+constexpr size_t cache_line_size = 64;
+
+/// Any Lockable padded to the cache line
+template <typename MutexTy>
+struct alignas(cache_line_size) padded_mutex : MutexTy {};
+
+/// Plain non-recursive std::mutex
+using plain_mutex = padded_mutex<std::mutex>;
+
+/*!
+ * \brief Fair FIFO spinlock. Good for tiny critical sections
+ * with few threads, terrible when there are more threads than cores.
+ * \note Not recursive.
+ */
+class alignas(cache_line_size) ticket_spinlock {
+public:
+    ticket_spinlock() = default;
+
+    ticket_spinlock(const ticket_spinlock &) = delete;
+    ticket_spinlock &operator =(const ticket_spinlock &) = delete;
+
+    void lock() {
+        const auto ticket = m_next.fetch_add(1, std::memory_order_relaxed);
+        for (;;) {
+            const auto serving = m_serving.load(std::memory_order_acquire);
+            if (serving == ticket) {
+                return;
+            }
+            // the farther we are in the queue, the longer we wait
+            for (uint32_t i = (ticket - serving) * 32; i != 0; --i) {
+                FCL_MUTEXES_PAUSE();
+            }
+        }
+    }
+
+    bool try_lock() {
+        auto ticket = m_serving.load(std::memory_order_relaxed);
+        return m_next.compare_exchange_strong(
+            ticket, ticket + 1,
+            std::memory_order_acquire,
+            std::memory_order_relaxed);
+    }
+
+    void unlock() {
+        m_serving.store(
+            m_serving.load(std::memory_order_relaxed) + 1,
+            std::memory_order_release);
+    }
+
+private:
+    std::atomic<uint32_t> m_next{ 0 };
+    std::atomic<uint32_t> m_serving{ 0 };
+};
+
+/*!
+ * \brief Spins for a while and then sleeps on futex (yields on non-Linux).
+ * Uncontended lock/unlock is a single atomic operation each.
+ * \note Not recursive.
+ */
+class alignas(cache_line_size) adaptive_mutex {
+    enum : int { unlocked = 0, locked = 1, contended = 2 };
+    static constexpr int spin_count = 100;
+
+public:
+    adaptive_mutex() = default;
+
+    adaptive_mutex(const adaptive_mutex &) = delete;
+    adaptive_mutex &operator =(const adaptive_mutex &) = delete;
+
+    void lock() {
+        for (int i = 0; i < spin_count; ++i) {
+            if (m_state.load(std::memory_order_relaxed) == unlocked && try_lock()) {
+                return;
+            }
+            FCL_MUTEXES_PAUSE();
+        }
+
+        while (m_state.exchange(contended, std::memory_order_acquire) != unlocked) {
+            wait();
+        }
+    }
+
+    bool try_lock() {
+        int expected = unlocked;
+        return m_state.compare_exchange_strong(
+            expected, locked,
+            std::memory_order_acquire,
+            std::memory_order_relaxed);
+    }
+
+    void unlock() {
+        if (m_state.exchange(unlocked, std::memory_order_release) == contended) {
+            wake();
+        }
+    }
+
+private:
+#ifdef __linux__
+    static_assert(sizeof(std::atomic<int>) == sizeof(int), "futex needs plain int layout");
+
+    void wait() {
+        syscall(SYS_futex, reinterpret_cast<int *>(&m_state),
+            FUTEX_WAIT_PRIVATE, static_cast<int>(contended), nullptr, nullptr, 0);
+    }
+
+    void wake() {
+        syscall(SYS_futex, reinterpret_cast<int *>(&m_state),
+            FUTEX_WAKE_PRIVATE, 1, nullptr, nullptr, 0);
+    }
+#else
+    void wait() {
+        std::this_thread::yield();
+    }
+
+    void wake() {}
+#endif // __linux__
+
+    std::atomic<int> m_state{ unlocked };
+};
+}
+
+#undef FCL_MUTEXES_PAUSE
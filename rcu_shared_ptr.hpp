@@ -0,0 +1,247 @@
+#pragma once
+#include <memory>
+#include <mutex>
+#include <atomic>
+#include <thread>
+#include <utility>
+#include <cstdint>
+#include <cassert>
+
+
+namespace fcl {
+namespace details {
+    // Padded rather than aligned: C++14 operator new ignores extended alignment
+    struct rcu_reader_record {
+        std::atomic<uint64_t> epoch{ 0 }; // 0 means "not reading"
+        char padding[64 - sizeof(std::atomic<uint64_t>)];
+        std::atomic<bool> in_use{ false };
+        rcu_reader_record *next = nullptr;
+        unsigned nesting = 0; // touched by the owner thread only
+    };
+
+    /*!
+     * \brief Epoch-based reclamation shared by all rcu_shared_ptr's.
+     *
+     * Reader publishes global epoch it has seen in its own record, writer
+     * bumps the epoch and waits until every reader either left or has seen
+     * the new one. Records live on a lock-free list and are reused by new
+     * threads, so the list is as long as the max number of concurrent readers.
+     */
+    class rcu_domain {
+    public:
+        static rcu_domain &instance() {
+            // never destroyed: thread_local records may outlive statics
+            static rcu_domain &domain = *new rcu_domain;
+            return domain;
+        }
+
+        rcu_reader_record &this_thread_record() {
+            struct record_holder {
+                rcu_reader_record *record;
+
+                record_holder()
+                    : record(rcu_domain::instance().acquire_record()) {}
+
+                ~record_holder() {
+                    record->in_use.store(false, std::memory_order_release);
+                }
+            };
+            static thread_local record_holder holder;
+            return *holder.record;
+        }
+
+        void read_lock(rcu_reader_record &record) {
+            if (record.nesting++ == 0) {
+                record.epoch.store(m_epoch.load());
+            }
+        }
+
+        void read_unlock(rcu_reader_record &record) {
+            assert(record.nesting > 0);
+            if (--record.nesting == 0) {
+                record.epoch.store(0, std::memory_order_release);
+            }
+        }
+
+        /// Waits until every reader that could see old data has left.
+        void synchronize() {
+            const auto target = m_epoch.fetch_add(1) + 1;
+            for (auto *record = m_records.load(); record; record = record->next) {
+                for (;;) {
+                    const auto epoch = record->epoch.load();
+                    if (epoch == 0 || epoch >= target) {
+                        break;
+                    }
+                    std::this_thread::yield();
+                }
+            }
+        }
+
+    private:
+        rcu_domain() = default;
+
+        rcu_reader_record *acquire_record() {
+            for (auto *record = m_records.load(); record; record = record->next) {
+                bool expected = false;
+                if (!record->in_use.load(std::memory_order_relaxed)
+                        && record->in_use.compare_exchange_strong(expected, true)) {
+                    return record;
+                }
+            }
+
+            auto *record = new rcu_reader_record;
+            record->in_use.store(true, std::memory_order_relaxed);
+            record->next = m_records.load();
+            while (!m_records.compare_exchange_weak(record->next, record)) {}
+            return record;
+        }
+
+        std::atomic<uint64_t> m_epoch{ 1 };
+        std::atomic<rcu_reader_record *> m_records{ nullptr };
+    };
+}
+
+/*!
+ * \brief Read-copy-update flavour of locking_shared_ptr.
+ *
+ * Readers get immutable snapshot without taking any lock: read() is a couple
+ * of atomic operations on the thread's own cache line. Writers copy the current
+ * value, modify the copy and publish it, then wait for readers of the old version
+ * to leave and destroy it. Writers are serialized.
+ * \note Don't call update()/store() while holding a snapshot on the same thread, it
+ * deadlocks. Don't keep snapshots for long, writers wait for them.
+ */
+template <typename Ty>
+class rcu_shared_ptr {
+    struct state_t {
+        std::atomic<const Ty *> m_ptr;
+        std::mutex m_writer_mutex;
+
+        explicit state_t(const Ty *ptr)
+            : m_ptr(ptr) {}
+
+        ~state_t() {
+            delete m_ptr.load();
+        }
+    };
+
+public:
+    class snapshot {
+        friend class rcu_shared_ptr;
+
+    public:
+        snapshot(const snapshot &) = delete;
+        snapshot &operator =(const snapshot &) = delete;
+
+        snapshot(snapshot &&other)
+            : m_record(other.m_record)
+            , m_ptr(other.m_ptr) {
+            other.m_record = nullptr;
+        }
+
+        snapshot &operator =(snapshot &&other) {
+            if (this != &other) {
+                release();
+                m_record = other.m_record;
+                m_ptr = other.m_ptr;
+                other.m_record = nullptr;
+            }
+            return *this;
+        }
+
+        ~snapshot() {
+            release();
+        }
+
+        const Ty *operator->() const {
+            return m_ptr;
+        }
+
+        const Ty &operator*() const {
+            return *m_ptr;
+        }
+
+        const Ty *get() const {
+            return m_ptr;
+        }
+
+    private:
+        snapshot(details::rcu_reader_record &record, const std::atomic<const Ty *> &ptr)
+            : m_record(&record) {
+            details::rcu_domain::instance().read_lock(record);
+            m_ptr = ptr.load();
+        }
+
+        void release() {
+            if (m_record) {
+                details::rcu_domain::instance().read_unlock(*m_record);
+                m_record = nullptr;
+            }
+        }
+
+        details::rcu_reader_record *m_record;
+        const Ty *m_ptr;
+    };
+
+public:
+    rcu_shared_ptr()
+        : m_state(std::make_shared<state_t>(new Ty())) {}
+
+    /// Takes ownership of ptr
+    explicit rcu_shared_ptr(Ty *ptr)
+        : m_state(std::make_shared<state_t>(ptr)) {}
+
+    rcu_shared_ptr(Ty &&data)
+        : m_state(std::make_shared<state_t>(new Ty(std::move(data)))) {}
+
+    rcu_shared_ptr(const Ty &data)
+        : m_state(std::make_shared<state_t>(new Ty(data))) {}
+
+    rcu_shared_ptr(const rcu_shared_ptr &) = default;
+    rcu_shared_ptr &operator =(const rcu_shared_ptr &) = default;
+
+    rcu_shared_ptr(rcu_shared_ptr &&) = default;
+    rcu_shared_ptr &operator =(rcu_shared_ptr &&) = default;
+
+    snapshot read() const {
+        return { details::rcu_domain::instance().this_thread_record(), m_state->m_ptr };
+    }
+
+    /// Calls fn(Ty &) on a copy of the current value and publishes the copy.
+    template <typename Fn>
+    void update(Fn &&fn) {
+        std::lock_guard<std::mutex> lock(m_state->m_writer_mutex);
+        std::unique_ptr<Ty> next(new Ty(*m_state->m_ptr.load()));
+        std::forward<Fn>(fn)(*next);
+        publish(next.release());
+    }
+
+    void store(Ty data) {
+        std::unique_ptr<Ty> next(new Ty(std::move(data)));
+        std::lock_guard<std::mutex> lock(m_state->m_writer_mutex);
+        publish(next.release());
+    }
+
+    ///\note You can use it wrong. At your own risk of course.
+    const Ty *unsafe_ptr() const {
+        return m_state->m_ptr.load();
+    }
+
+private:
+    void publish(const Ty *next) {
+        auto &domain = details::rcu_domain::instance();
+        assert(domain.this_thread_record().nesting == 0
+            && "rcu_shared_ptr is updated while this thread holds a snapshot");
+        std::unique_ptr<const Ty> old(m_state->m_ptr.exchange(next));
+        domain.synchronize();
+    }
+
+    std::shared_ptr<state_t> m_state;
+};
+
+
+template <typename Ty, typename ...Args>
+auto make_rcu_shared(Args &&...args) -> rcu_shared_ptr<Ty> {
+    return rcu_shared_ptr<Ty>(new Ty(std::forward<Args>(args)...));
+}
+}
@@ -0,0 +1,310 @@
+#pragma once
+#include <mutex>
+#include <shared_mutex>
+#include <memory>
+#include <atomic>
+#include <array>
+#include <thread>
+#include <cstdint>
+#include <cassert>
+#if defined(__x86_64__) || defined(__i386__) || defined(_M_X64) || defined(_M_IX86)
+#   include <immintrin.h>
+#endif
+
+
+namespace fcl {
+namespace details {
+    inline void brlock_relax(unsigned &spins) {
+        if (++spins < 64) {
+#if defined(__x86_64__) || defined(__i386__) || defined(_M_X64) || defined(_M_IX86)
+            _mm_pause();
+#endif
+        } else {
+            std::this_thread::yield();
+        }
+    }
+}
+
+/*!
+ * \brief "Big reader" lock. Satisfies SharedMutex requirements.
+ *
+ * Every thread gets its own reader counter (threads are spread over ShardsNb
+ * cache lines), so readers never write to a cache line shared with other cores.
+ * Writer has to visit all shards, so it's expensive: use it for read-mostly data only.
+ * \note Not recursive, both for readers and for writers.
+ */
+template <size_t ShardsNb = 64>
+class brlock {
+    static_assert(ShardsNb > 0, "brlock needs at least one shard");
+
+public:
+    brlock() = default;
+
+    brlock(const brlock &) = delete;
+    brlock &operator =(const brlock &) = delete;
+
+    void lock() {
+        m_writer_mutex.lock();
+        m_writer.store(true);
+        for (auto &shard : m_shards) {
+            unsigned spins = 0;
+            while (shard.readers.load() != 0) {
+                details::brlock_relax(spins);
+            }
+        }
+    }
+
+    bool try_lock() {
+        if (!m_writer_mutex.try_lock()) {
+            return false;
+        }
+        m_writer.store(true);
+        for (auto &shard : m_shards) {
+            if (shard.readers.load() != 0) {
+                unlock();
+                return false;
+            }
+        }
+        return true;
+    }
+
+    void unlock() {
+        m_writer.store(false, std::memory_order_release);
+        m_writer_mutex.unlock();
+    }
+
+    void lock_shared() {
+        auto &readers = m_shards[slot()].readers;
+        for (;;) {
+            readers.fetch_add(1);
+            if (!m_writer.load()) {
+                return;
+            }
+            readers.fetch_sub(1, std::memory_order_release);
+            unsigned spins = 0;
+            while (m_writer.load(std::memory_order_relaxed)) {
+                details::brlock_relax(spins);
+            }
+        }
+    }
+
+    bool try_lock_shared() {
+        auto &readers = m_shards[slot()].readers;
+        readers.fetch_add(1);
+        if (!m_writer.load()) {
+            return true;
+        }
+        readers.fetch_sub(1, std::memory_order_release);
+        return false;
+    }
+
+    void unlock_shared() {
+        m_shards[slot()].readers.fetch_sub(1, std::memory_order_release);
+    }
+
+private:
+    static size_t slot() {
+        static std::atomic<size_t> next_slot(0);
+        static thread_local const size_t this_slot =
+            next_slot.fetch_add(1, std::memory_order_relaxed) % ShardsNb;
+        return this_slot;
+    }
+
+    struct alignas(64) shard_t {
+        std::atomic<uint32_t> readers{ 0 };
+    };
+
+    std::array<shard_t, ShardsNb> m_shards;
+    alignas(64) std::atomic<bool> m_writer{ false };
+    std::mutex m_writer_mutex;
+};
+
+
+/*!
+ * \brief Same as mutex_guard, but clock_guard's are shared: any number of
+ * const accessors may hold the data at the same time.
+ * \note Unlike mutex_guard it's not recursive.
+ */
+template <typename Ty, typename SharedMutexTy = std::shared_timed_mutex>
+class shared_mutex_guard {
+public:
+    using mutex_t = SharedMutexTy;
+
+    template <typename InnerTy, typename LockTy>
+    class lock_guard_base {
+        friend class shared_mutex_guard;
+
+    public:
+        lock_guard_base(const lock_guard_base &) = delete;
+        lock_guard_base &operator =(const lock_guard_base &) = delete;
+
+        lock_guard_base(lock_guard_base &&) = default;
+        lock_guard_base &operator =(lock_guard_base &&) = default;
+
+        const InnerTy *operator->() const {
+            assert(owns_lock());
+            return unsafe_ptr();
+        }
+
+        ///\note You can use it wrong. At your own risk of course.
+        const InnerTy *unsafe_ptr() const {
+            assert(owns_lock());
+            return &m_data;
+        }
+
+        ///\note You can use it wrong. At your own risk of course.
+        const InnerTy &unsafe_ref() const {
+            assert(owns_lock());
+            return m_data;
+        }
+
+        /// Use it if you have tried to lock.
+        bool owns_lock() const {
+            return m_lock.owns_lock();
+        }
+
+    protected:
+        lock_guard_base(mutex_t &mutex, InnerTy &data)
+            : m_lock(mutex)
+            , m_data(data) {}
+
+        lock_guard_base(mutex_t &mutex, std::try_to_lock_t, InnerTy &data)
+            : m_lock(mutex, std::try_to_lock)
+            , m_data(data) {}
+
+        LockTy m_lock;
+        InnerTy &m_data;
+    };
+
+    class lock_guard : public lock_guard_base<Ty, std::unique_lock<mutex_t>> {
+        friend class shared_mutex_guard;
+        using base_t = lock_guard_base<Ty, std::unique_lock<mutex_t>>;
+
+    public:
+        lock_guard(const lock_guard &) = delete;
+        lock_guard &operator =(const lock_guard &) = delete;
+
+        lock_guard(lock_guard &&) = default;
+        lock_guard &operator =(lock_guard &&) = default;
+
+        Ty *operator->() {
+            assert(this->owns_lock());
+            return unsafe_ptr();
+        }
+
+        Ty &unsafe_ref() {
+            assert(this->owns_lock());
+            return this->m_data;
+        }
+
+        Ty *unsafe_ptr() {
+            assert(this->owns_lock());
+            return &this->m_data;
+        }
+
+    private:
+        lock_guard(mutex_t &mutex, Ty &data)
+            : base_t(mutex, data) {}
+
+        lock_guard(mutex_t &mutex, std::try_to_lock_t, Ty &data)
+            : base_t(mutex, std::try_to_lock, data) {}
+    };
+
+    class clock_guard : public lock_guard_base<const Ty, std::shared_lock<mutex_t>> {
+        friend class shared_mutex_guard;
+        using base_t = lock_guard_base<const Ty, std::shared_lock<mutex_t>>;
+
+    public:
+        clock_guard(const clock_guard &) = delete;
+        clock_guard &operator =(const clock_guard &) = delete;
+
+        clock_guard(clock_guard &&) = default;
+        clock_guard &operator =(clock_guard &&) = default;
+
+    private:
+        clock_guard(mutex_t &mutex, const Ty &data)
+            : base_t(mutex, data) {}
+
+        clock_guard(mutex_t &mutex, std::try_to_lock_t, const Ty &data)
+            : base_t(mutex, std::try_to_lock, data) {}
+    };
+
+    using opt_lock_guard = std::unique_ptr<lock_guard>;
+    using opt_clock_guard = std::unique_ptr<clock_guard>;
+
+public:
+    shared_mutex_guard() = default;
+
+    shared_mutex_guard(Ty &&data)
+        : m_data(std::move(data)) {}
+
+    shared_mutex_guard(const Ty &data)
+        : m_data(data) {}
+
+    template <typename ...Args>
+    shared_mutex_guard(Args &&...args)
+        : m_data(std::forward<Args>(args)...) {}
+
+    shared_mutex_guard(const shared_mutex_guard &) = delete;
+    shared_mutex_guard &operator=(const shared_mutex_guard &) = delete;
+
+    /// Exclusive access
+    lock_guard lock() {
+        return { m_mutex, m_data };
+    }
+
+    opt_lock_guard try_to_lock() {
+        auto guard = lock_guard{ m_mutex, std::try_to_lock, m_data };
+        if (guard.owns_lock()) {
+            return opt_lock_guard(new lock_guard(std::move(guard)));
+        }
+        return nullptr;
+    }
+
+    /// Shared access
+    clock_guard lock() const {
+        return { m_mutex, m_data };
+    }
+
+    opt_clock_guard try_to_lock() const {
+        auto guard = clock_guard{ m_mutex, std::try_to_lock, m_data };
+        if (guard.owns_lock()) {
+            return opt_clock_guard(new clock_guard(std::move(guard)));
+        }
+        return nullptr;
+    }
+
+    /// Shared access without casting guard to const
+    clock_guard lock_shared() const {
+        return lock();
+    }
+
+    opt_clock_guard try_to_lock_shared() const {
+        return try_to_lock();
+    }
+
+    Ty &nolock_unsafe_ref() {
+        return m_data;
+    }
+
+    const Ty &nolock_unsafe_ref() const {
+        return m_data;
+    }
+
+    const Ty *nolock_unsafe_ptr() const {
+        return &m_data;
+    }
+
+    Ty *nolock_unsafe_ptr() {
+        return &m_data;
+    }
+
+private:
+    Ty m_data;
+    mutable mutex_t m_mutex;
+};
+
+/// shared_mutex_guard with per-core reader counters
+template <typename Ty, size_t ShardsNb = 64>
+using brlock_guard = shared_mutex_guard<Ty, brlock<ShardsNb>>;
+}